@@ -0,0 +1,88 @@
+/*
+  ==============================================================================
+
+    Console front end for the plugin's DSP, for use without a plugin host.
+
+  ==============================================================================
+*/
+
+#include <JuceHeader.h>
+#include "../Source/PluginProcessor.h"
+#include "../Source/ReferenceMatcher.h"
+
+//==============================================================================
+static void runTests(const juce::ArgumentList&)
+{
+    juce::UnitTestRunner runner;
+    runner.setAssertOnFailure(false);
+    runner.runTestsInCategory("3BandEQ");
+
+    int numFailures = 0;
+
+    for (int i = 0; i < runner.getNumResults(); ++i)
+        numFailures += runner.getResult(i)->failures;
+
+    if (numFailures > 0)
+        juce::ConsoleApplication::fail(juce::String(numFailures) + " test(s) failed");
+}
+
+static void matchReference(const juce::ArgumentList& args)
+{
+    args.checkMinNumArguments(3);
+
+    auto referenceFile = args[1].resolveAsExistingFile();
+    auto targetFile = args[2].resolveAsExistingFile();
+
+    ReferenceMatcher matcher;
+    ChainSettings settings;
+
+    auto result = matcher.match(referenceFile, targetFile, settings);
+
+    if (result.failed())
+        juce::ConsoleApplication::fail(result.getErrorMessage());
+
+    std::cout << "LowCut Freq:   " << settings.lowCutFreq << " Hz" << std::endl
+              << "LowCut Slope:  " << 12 * (settings.lowCutSlope + 1) << " db/Oct" << std::endl
+              << "HighCut Freq:  " << settings.highCutFreq << " Hz" << std::endl
+              << "HighCut Slope: " << 12 * (settings.highCutSlope + 1) << " db/Oct" << std::endl
+              << "Peak Freq:     " << settings.peakFreq << " Hz" << std::endl
+              << "Peak Gain:     " << settings.peakGainInDecibels << " dB" << std::endl
+              << "Peak Q:        " << settings.peakQ << std::endl;
+
+    // The state is written the way a host stores it, so it can be loaded as the plugin's state.
+    if (args.size() > 3)
+    {
+        auto stateFile = args[3].resolveAsFile();
+
+        SimpleEQ_SCAudioProcessor processor;
+        setChainSettings(processor.apvts, settings);
+
+        juce::MemoryBlock state;
+        processor.getStateInformation(state);
+
+        if (! stateFile.replaceWithData(state.getData(), state.getSize()))
+            juce::ConsoleApplication::fail("Unable to write " + stateFile.getFullPathName());
+    }
+}
+
+//==============================================================================
+int main(int argc, char* argv[])
+{
+    // The processor expects a message manager, as it has inside a host.
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    juce::ConsoleApplication app;
+
+    app.addHelpCommand("--help|-h", "3BandEQ_Console", true);
+
+    app.addCommand({ "--test", "--test",
+                     "Runs the 3BandEQ unit tests and logs their results.", {},
+                     runTests });
+
+    app.addCommand({ "--match", "--match <reference> <target> [<state file>]",
+                     "Fits the band settings so that the target, run through the EQ, matches the reference.",
+                     "Prints the settings, and if a state file is given, writes the plugin state for them to it.",
+                     matchReference });
+
+    return app.findAndRunCommand(argc, argv);
+}
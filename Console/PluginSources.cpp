@@ -0,0 +1,14 @@
+/*
+  ==============================================================================
+
+    Builds the plugin processor into the console app. The processor sources
+    expect the macros a plugin build defines, so they are provided here.
+
+  ==============================================================================
+*/
+
+#ifndef JucePlugin_Name
+ #define JucePlugin_Name "3BandEQ_SC"
+#endif
+
+#include "../Source/PluginProcessor.cpp"
@@ -0,0 +1,443 @@
+/*
+  ==============================================================================
+
+    Closed-form coefficient design for the filters used by the plugin.
+
+  ==============================================================================
+*/
+
+#include "FastFilterDesign.h"
+
+namespace FastFilterDesign
+{
+    namespace
+    {
+        // 1 / Q of each Butterworth section, 2 * cos ((2i + 1) * pi / (2 * order)),
+        // in the same order FilterDesign returns them.
+        constexpr double butterworthInverseQ[4][4] =
+        {
+            { 1.4142135623730951, 0.0,                0.0,                0.0                }, // order 2
+            { 1.8477590650225735, 0.7653668647301796, 0.0,                0.0                }, // order 4
+            { 1.9318516525781366, 1.4142135623730951, 0.5176380902050415, 0.0                }, // order 6
+            { 1.9615705608064609, 1.6629392246050905, 1.1111404660392044, 0.3901806440322565 }  // order 8
+        };
+
+        // Keeps tan() finite for cut frequencies at or above Nyquist.
+        constexpr double maxNormalisedFrequency = 0.4999;
+
+        double prewarp(float frequency, double sampleRate)
+        {
+            auto normalised = juce::jmin(static_cast<double>(frequency) / sampleRate, maxNormalisedFrequency);
+            return fastTan(juce::MathConstants<double>::pi * normalised);
+        }
+    }
+
+    double fastTan(double x)
+    {
+        jassert(x >= 0.0 && x < juce::MathConstants<double>::halfPi);
+
+        // Reflect into [0, pi/4] with tan(x) = 1 / tan(pi/2 - x). pi/2 is split in two
+        // parts so the reflection stays accurate right below Nyquist.
+        const bool reflect = x > juce::MathConstants<double>::pi * 0.25;
+        const double y = reflect ? (1.5707963267948966 - x) + 6.123233995736766e-17 : x;
+        const double z = y * y;
+
+        // Taylor series of sin and cos, both accurate to double precision on [0, pi/4]
+        const double sine = y * (1.0 + z * (-1.0 / 6.0 + z * (1.0 / 120.0 + z * (-1.0 / 5040.0 + z * (1.0 / 362880.0
+                          + z * (-1.0 / 39916800.0 + z * (1.0 / 6227020800.0 + z * (-1.0 / 1307674368000.0))))))));
+        const double cosine = 1.0 + z * (-0.5 + z * (1.0 / 24.0 + z * (-1.0 / 720.0 + z * (1.0 / 40320.0
+                            + z * (-1.0 / 3628800.0 + z * (1.0 / 479001600.0 + z * (-1.0 / 87178291200.0
+                            + z * (1.0 / 20922789888000.0))))))));
+
+        return reflect ? cosine / sine : sine / cosine;
+    }
+
+    double fastExp2(double x)
+    {
+        const double whole = std::floor(x + 0.5);
+        const double u = (x - whole) * 0.69314718055994531;
+
+        // Taylor series of e^u, accurate to double precision for |u| <= ln(2) / 2
+        const double p = 1.0 + u * (1.0 + u * (1.0 / 2.0 + u * (1.0 / 6.0 + u * (1.0 / 24.0 + u * (1.0 / 120.0
+                       + u * (1.0 / 720.0 + u * (1.0 / 5040.0 + u * (1.0 / 40320.0 + u * (1.0 / 362880.0
+                       + u * (1.0 / 3628800.0 + u * (1.0 / 39916800.0 + u * (1.0 / 479001600.0
+                       + u * (1.0 / 6227020800.0)))))))))))));
+
+        const auto bits = static_cast<juce::int64>(static_cast<juce::int64>(whole) + 1023) << 52;
+        double scale;
+        std::memcpy(&scale, &bits, sizeof(scale));
+
+        return p * scale;
+    }
+
+    CutSections designCutSections(float frequency, double sampleRate, int order, bool isHighpass)
+    {
+        jassert(sampleRate > 0);
+        jassert(frequency > 0);
+        jassert(order == 2 || order == 4 || order == 6 || order == 8);
+
+        const double* inverseQ = butterworthInverseQ[juce::jlimit(0, 3, order / 2 - 1)];
+
+        const double t = prewarp(frequency, sampleRate);
+        const double tSquared = t * t;
+        const double numerator = isHighpass ? 1.0 : tSquared;
+        const double b1Sign = isHighpass ? -2.0 : 2.0;
+
+        // Same bilinear transform as IIR::Coefficients::makeLowPass / makeHighPass, with the
+        // numerator and denominator scaled by tan^2 for the lowpass case. a1 and a2 are
+        // expressed as offsets from -2 and 1 so that low cutoffs keep their precision.
+        // The design runs in double. a2 absorbs the rounding error of a1, so 1 + a1 + a2,
+        // which sets the response around and below the cutoff, is within half a float ulp
+        // of the exact value.
+        // Fixed-length loop so all sections are designed in one vectorisable pass.
+        CutSections sections;
+
+        for (size_t i = 0; i < sections.size(); ++i)
+        {
+            const double twoInverseQT = 2.0 * inverseQ[i] * t;
+            const double d = 1.0 / (1.0 + inverseQ[i] * t + tSquared);
+            const double b0 = numerator * d;
+
+            const double a1 = -2.0 + (4.0 * tSquared + twoInverseQT) * d;
+
+            auto& section = sections[i];
+            section.b0 = static_cast<float>(b0);
+            section.b1 = static_cast<float>(b1Sign * b0);
+            section.b2 = section.b0;
+            section.a1 = static_cast<float>(a1);
+            section.a2 = static_cast<float>((1.0 - twoInverseQT * d) + (a1 - section.a1));
+        }
+
+        return sections;
+    }
+
+    BiquadSection designPeakSection(float frequency, float Q, float gainInDecibels, double sampleRate)
+    {
+        jassert(sampleRate > 0);
+        jassert(Q > 0);
+
+        // sqrt (decibelsToGain (gain)) == 10^(gain / 40) == 2^(gain * log2 (10) / 40)
+        const double A = fastExp2(gainInDecibels * 0.083048202372184058);
+
+        // sin and cos of omega follow from t = tan (omega / 2), so one tan() replaces
+        // the sin(), cos() and pow() of IIR::Coefficients::makePeakFilter.
+        const double t = prewarp(juce::jmax(frequency, 2.f), sampleRate);
+        const double k = t / Q;
+        const double kTimesA = k * A;
+        const double kOverA = k / A;
+        const double inverseA0 = 1.0 / (1.0 + t * t + kOverA);
+        const double b0 = 1.0 + (kTimesA - kOverA) * inverseA0;
+        const double a1 = -2.0 + 2.0 * (2.0 * t * t + kOverA) * inverseA0;
+
+        // As for the cuts, b2 and a2 absorb the rounding error of the coefficients before
+        // them, so both b0 + b1 + b2 and 1 + a1 + a2 are within half a float ulp of exact.
+        BiquadSection section;
+        section.b0 = static_cast<float>(b0);
+        section.a1 = static_cast<float>(a1);
+        section.b1 = section.a1;
+        section.b2 = static_cast<float>((1.0 - (kTimesA + kOverA) * inverseA0) + (b0 - section.b0) + (a1 - section.b1));
+        section.a2 = static_cast<float>((1.0 - 2.0 * kOverA * inverseA0) + (a1 - section.a1));
+
+        return section;
+    }
+}
+
+//==============================================================================
+#if JUCE_UNIT_TESTS
+
+class FastFilterDesignTests : public juce::UnitTest
+{
+public:
+    FastFilterDesignTests() : juce::UnitTest("FastFilterDesign", "3BandEQ") {}
+
+    void runTest() override
+    {
+        beginTest("Cut filters match the double-precision Butterworth design");
+        {
+            DesignErrors fast, current;
+
+            for (auto sampleRate : sampleRates)
+                for (auto frequency : getParameterFrequencies())
+                    for (int order = 2; order <= 8; order += 2)
+                        for (auto isHighpass : { false, true })
+                        {
+                            auto sections = FastFilterDesign::designCutSections(frequency, sampleRate, order, isHighpass);
+
+                            auto reference = isHighpass
+                                ? juce::dsp::FilterDesign<double>::designIIRHighpassHighOrderButterworthMethod(frequency, sampleRate, order)
+                                : juce::dsp::FilterDesign<double>::designIIRLowpassHighOrderButterworthMethod(frequency, sampleRate, order);
+
+                            auto currentDesign = isHighpass
+                                ? juce::dsp::FilterDesign<float>::designIIRHighpassHighOrderButterworthMethod(frequency, sampleRate, order)
+                                : juce::dsp::FilterDesign<float>::designIIRLowpassHighOrderButterworthMethod(frequency, sampleRate, order);
+
+                            for (int i = 0; i < order / 2; ++i)
+                                fast.addCoefficients(sections[(size_t) i], *reference[i], false);
+
+                            auto tier = getTier(frequency, sampleRate, cutTolerances);
+
+                            for (auto probe : getProbeFrequencies(sampleRate))
+                            {
+                                Response expected, actual, currentActual;
+
+                                for (int i = 0; i < order / 2; ++i)
+                                {
+                                    expected.add(*reference[i], probe, sampleRate);
+                                    actual.add(toCoefficients(sections[(size_t) i]), probe, sampleRate);
+                                    currentActual.add(*currentDesign[i], probe, sampleRate);
+                                }
+
+                                // The stopband is only compared down to -60 dB.
+                                if (juce::Decibels::gainToDecibels(expected.magnitude, -200.0) < -60.0)
+                                    continue;
+
+                                fast.responses[tier].add(expected, actual);
+                                current.responses[tier].add(expected, currentActual);
+                            }
+                        }
+
+            checkTolerances(fast, current, cutTolerances, "FilterDesign<float>");
+        }
+
+        beginTest("Peak filters match the double-precision design");
+        {
+            DesignErrors fast, current;
+
+            for (auto sampleRate : sampleRates)
+                for (auto frequency : getParameterFrequencies())
+                    for (float gain = -24.f; gain <= 24.f; gain += 1.5f)
+                        for (int q = 0; q <= 8; ++q)
+                        {
+                            auto Q = 0.1f * std::pow(100.f, (float) q / 8.f);
+
+                            auto section = FastFilterDesign::designPeakSection(frequency, Q, gain, sampleRate);
+
+                            auto reference = juce::dsp::IIR::Coefficients<double>::makePeakFilter(sampleRate, frequency, Q,
+                                juce::Decibels::decibelsToGain((double) gain));
+
+                            auto currentDesign = juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, frequency, Q,
+                                juce::Decibels::decibelsToGain(gain));
+
+                            fast.addCoefficients(section, *reference, true);
+
+                            auto tier = getTier(frequency, sampleRate, peakTolerances);
+
+                            for (auto probe : getProbeFrequencies(sampleRate))
+                            {
+                                Response expected, actual, currentActual;
+
+                                expected.add(*reference, probe, sampleRate);
+                                actual.add(toCoefficients(section), probe, sampleRate);
+                                currentActual.add(*currentDesign, probe, sampleRate);
+
+                                fast.responses[tier].add(expected, actual);
+                                current.responses[tier].add(expected, currentActual);
+                            }
+                        }
+
+            checkTolerances(fast, current, peakTolerances, "makePeakFilter<float>");
+        }
+
+        beginTest("Transcendental approximations");
+        {
+            double tanError = 0, exp2Error = 0;
+
+            for (int i = 0; i < 10000; ++i)
+            {
+                auto x = (double) i / 10000.0 * juce::MathConstants<double>::halfPi;
+                tanError = juce::jmax(tanError, std::abs(FastFilterDesign::fastTan(x) / std::tan(x) - 1.0));
+            }
+
+            for (int i = 0; i <= 10000; ++i)
+            {
+                auto x = -8.0 + 16.0 * (double) i / 10000.0;
+                exp2Error = juce::jmax(exp2Error, std::abs(FastFilterDesign::fastExp2(x) / std::exp2(x) - 1.0));
+            }
+
+            logMessage("fastTan " + juce::String(tanError) + ", fastExp2 " + juce::String(exp2Error));
+
+            expectLessThan(tanError, 1.0e-15);
+            expectLessThan(exp2Error, 1.0e-15);
+        }
+    }
+
+private:
+    static constexpr double sampleRates[] = { 44100.0, 48000.0, 88200.0, 96000.0, 192000.0 };
+
+    // Maximum response errors against the double-precision JUCE design, by the design
+    // frequency relative to the sample rate. The coefficient checks pin the design itself
+    // down to rounding; these bound what storing it in float costs. That cost grows as the
+    // poles approach the unit circle at low normalised frequencies, so the tiers loosen
+    // towards them. Each limit is about 1.25 times the measured error.
+    struct Tolerance
+    {
+        double minimumNormalisedFrequency, magnitudeDb, phase;
+    };
+
+    using Tolerances = std::array<Tolerance, 6>;
+
+    static constexpr Tolerances cutTolerances  { { { 0.005,   0.0006, 0.00015 },
+                                                   { 0.002,   0.0035, 0.0006  },
+                                                   { 0.001,   0.02,   0.0025  },
+                                                   { 0.0005,  0.045,  0.008   },
+                                                   { 0.00025, 0.27,   0.04    },
+                                                   { 0.0,     1.25,   0.2     } } };
+
+    static constexpr Tolerances peakTolerances { { { 0.005,   0.0045, 0.0008  },
+                                                   { 0.002,   0.022,  0.006   },
+                                                   { 0.001,   0.14,   0.015   },
+                                                   { 0.0005,  0.52,   0.09    },
+                                                   { 0.00025, 2.0,    0.19    },
+                                                   { 0.0,     4.8,    0.4     } } };
+
+    struct Response
+    {
+        double magnitude = 1.0, phase = 0.0;
+
+        template<typename CoefficientsType>
+        void add(const CoefficientsType& coefficients, double frequency, double sampleRate)
+        {
+            magnitude *= coefficients.getMagnitudeForFrequency(frequency, sampleRate);
+            phase += coefficients.getPhaseForFrequency(frequency, sampleRate);
+        }
+    };
+
+    struct ErrorStats
+    {
+        double magnitudeDb = 0.0, phase = 0.0;
+
+        void add(const Response& expected, const Response& actual)
+        {
+            auto magnitudeError = juce::Decibels::gainToDecibels(actual.magnitude, -200.0)
+                                - juce::Decibels::gainToDecibels(expected.magnitude, -200.0);
+
+            magnitudeDb = juce::jmax(magnitudeDb, std::abs(magnitudeError));
+            phase = juce::jmax(phase, std::abs(std::remainder(actual.phase - expected.phase, juce::MathConstants<double>::twoPi)));
+        }
+
+        juce::String toString() const
+        {
+            return juce::String(magnitudeDb, 4) + " dB / " + juce::String(phase, 4) + " rad";
+        }
+    };
+
+    struct DesignErrors
+    {
+        // Largest distance, in float ulps, between b0, b1 or a1 and the reference
+        // coefficient rounded to float.
+        juce::int64 maxUlps = 0;
+
+        // Largest error of the coefficient sums that b2 and a2 compensate, in ulps of
+        // the compensating coefficient.
+        double maxSumUlps = 0.0;
+
+        std::array<ErrorStats, std::tuple_size<Tolerances>::value> responses;
+
+        void addCoefficients(const FastFilterDesign::BiquadSection& actual,
+                             const juce::dsp::IIR::Coefficients<double>& expected, bool compensatesNumerator)
+        {
+            // JUCE stores b0, b1, b2, a1, a2 with a0 normalised away.
+            const auto* reference = expected.coefficients.begin();
+
+            for (auto [coefficient, index] : { std::make_pair(actual.b0, 0), std::make_pair(actual.b1, 1), std::make_pair(actual.a1, 3) })
+                maxUlps = juce::jmax(maxUlps, getUlps(coefficient, (float) reference[index]));
+
+            addSum((double) actual.a1 + (double) actual.a2, reference[3] + reference[4], actual.a2);
+
+            if (compensatesNumerator)
+                addSum((double) actual.b0 + (double) actual.b1 + (double) actual.b2,
+                       reference[0] + reference[1] + reference[2], actual.b2);
+        }
+
+        void addSum(double sum, double expectedSum, float compensatingCoefficient)
+        {
+            const auto magnitude = std::abs(compensatingCoefficient);
+            const auto ulp = (double) std::nextafter(magnitude, std::numeric_limits<float>::infinity()) - (double) magnitude;
+
+            maxSumUlps = juce::jmax(maxSumUlps, std::abs(sum - expectedSum) / ulp);
+        }
+
+        static juce::int64 getUlps(float a, float b)
+        {
+            // Floats of the same sign are ordered like their bit patterns.
+            juce::int32 aBits, bBits;
+            std::memcpy(&aBits, &a, sizeof(a));
+            std::memcpy(&bBits, &b, sizeof(b));
+
+            if (a == b)
+                return 0;
+
+            if ((aBits < 0) != (bBits < 0))
+                return std::numeric_limits<juce::int64>::max();
+
+            return std::abs((juce::int64) aBits - (juce::int64) bBits);
+        }
+    };
+
+    static size_t getTier(float frequency, double sampleRate, const Tolerances& tolerances)
+    {
+        size_t tier = 0;
+
+        while (tier < tolerances.size() - 1 && frequency < tolerances[tier].minimumNormalisedFrequency * sampleRate)
+            ++tier;
+
+        return tier;
+    }
+
+    void checkTolerances(const DesignErrors& fast, const DesignErrors& current, const Tolerances& tolerances, const juce::String& currentName)
+    {
+        logMessage("Max distance from the rounded double design: " + juce::String(fast.maxUlps) + " ulp, sums "
+                   + juce::String(fast.maxSumUlps, 3) + " ulp");
+
+        // 1 ulp and the extra 0.01 allow for the reference itself being off by a few
+        // double ulps next to a rounding boundary.
+        expectLessOrEqual(fast.maxUlps, (juce::int64) 1);
+        expectLessOrEqual(fast.maxSumUlps, 0.51);
+
+        for (size_t tier = 0; tier < tolerances.size(); ++tier)
+        {
+            const auto& tolerance = tolerances[tier];
+
+            logMessage("Max error above " + juce::String(tolerance.minimumNormalisedFrequency) + " * fs: "
+                       + fast.responses[tier].toString() + ", " + currentName + ": " + current.responses[tier].toString());
+
+            expectLessThan(fast.responses[tier].magnitudeDb, tolerance.magnitudeDb);
+            expectLessThan(fast.responses[tier].phase, tolerance.phase);
+
+            // No margin: the fast design must be at least as close to the reference as
+            // the float JUCE design it replaces, in every tier.
+            expectLessOrEqual(fast.responses[tier].magnitudeDb, current.responses[tier].magnitudeDb);
+            expectLessOrEqual(fast.responses[tier].phase, current.responses[tier].phase);
+        }
+    }
+
+    static juce::dsp::IIR::Coefficients<double> toCoefficients(const FastFilterDesign::BiquadSection& section)
+    {
+        return juce::dsp::IIR::Coefficients<double>(section.b0, section.b1, section.b2, 1.0, section.a1, section.a2);
+    }
+
+    // The parameter range of every frequency knob, 20 Hz to 20 kHz.
+    static std::vector<float> getParameterFrequencies()
+    {
+        std::vector<float> frequencies;
+
+        for (int i = 0; i <= 60; ++i)
+            frequencies.push_back(juce::mapToLog10((float) i / 60.f, 20.f, 20000.f));
+
+        return frequencies;
+    }
+
+    static std::vector<double> getProbeFrequencies(double sampleRate)
+    {
+        std::vector<double> frequencies;
+
+        for (int i = 0; i < 64; ++i)
+            frequencies.push_back(juce::mapToLog10((double) i / 63.0, 10.0, 0.49 * sampleRate));
+
+        return frequencies;
+    }
+};
+
+static FastFilterDesignTests fastFilterDesignTests;
+
+#endif
@@ -0,0 +1,58 @@
+/*
+  ==============================================================================
+
+    Closed-form coefficient design for the filters used by the plugin.
+
+    Replaces FilterDesign<float>::designIIR*HighOrderButterworthMethod and
+    IIR::Coefficients<float>::makePeakFilter on the audio thread. Only the
+    even Butterworth orders 2, 4, 6 and 8 are supported, so the section Q
+    values come from a table and every section of a cascade shares a single
+    tan() evaluation.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <array>
+
+namespace FastFilterDesign
+{
+    // Normalised second-order section (a0 == 1), laid out like the raw
+    // coefficient array of juce::dsp::IIR::Coefficients: b0, b1, b2, a1, a2.
+    struct BiquadSection
+    {
+        float b0 = 1.f, b1 = 0.f, b2 = 0.f, a1 = 0.f, a2 = 0.f;
+    };
+
+    using CutSections = std::array<BiquadSection, 4>;
+
+    // tan(x) for x in [0, pi/2), relative error below 1e-15.
+    double fastTan(double x);
+
+    // 2^x for |x| < 1022, relative error below 1e-15.
+    double fastExp2(double x);
+
+    // Designs all four sections at once; only the first order / 2 are meaningful.
+    CutSections designCutSections(float frequency, double sampleRate, int order, bool isHighpass);
+
+    BiquadSection designPeakSection(float frequency, float Q, float gainInDecibels, double sampleRate);
+
+    // |H|^2 of a section at the frequency where phi == sin^2 (omega / 2). Written in terms of
+    // phi (RBJ cookbook form) and evaluated in double, which keeps cutoffs near DC accurate.
+    // Callers evaluating many sections on a fixed grid only compute the trig once.
+    inline double getMagnitudeSquared(const BiquadSection& s, double phi)
+    {
+        const double b0 = s.b0, b1 = s.b1, b2 = s.b2, a1 = s.a1, a2 = s.a2;
+
+        const double numerator = (b0 + b1 + b2) * (b0 + b1 + b2)
+                               - 4.0 * (b0 * b1 + 4.0 * b0 * b2 + b1 * b2) * phi
+                               + 16.0 * b0 * b2 * phi * phi;
+        const double denominator = (1.0 + a1 + a2) * (1.0 + a1 + a2)
+                                 - 4.0 * (a1 + 4.0 * a2 + a1 * a2) * phi
+                                 + 16.0 * a2 * phi * phi;
+
+        return numerator / denominator;
+    }
+}
@@ -18,7 +18,8 @@ SimpleEQ_SCAudioProcessorEditor::SimpleEQ_SCAudioProcessorEditor(SimpleEQ_SCAudi
     lowCutSliderAttachment(audioProcessor.apvts, "LowCut Freq", lowCutSlider),
     highCutSliderAttachment(audioProcessor.apvts, "HighCut Freq", highCutSlider),
     lowCutSlopeSliderAttachment(audioProcessor.apvts, "LowCut Slope", lowCutSlopeSlider),
-    highCutSlopeSliderAttachment(audioProcessor.apvts, "HighCut Slope", highCutSlopeSlider)
+    highCutSlopeSliderAttachment(audioProcessor.apvts, "HighCut Slope", highCutSlopeSlider),
+    autoGainButtonAttachment(audioProcessor.apvts, "Auto Gain", autoGainButton)
 {
     // Make sure that before the constructor has finished, you've set the
     // editor's size to whatever you need it to be.
@@ -27,6 +28,10 @@ SimpleEQ_SCAudioProcessorEditor::SimpleEQ_SCAudioProcessorEditor(SimpleEQ_SCAudi
 
     startTimerHz(60);
 
+    autoGainButton.setTooltip("Keeps the loudness of pink noise through the EQ at the dry level, measured as "
+                              "ITU-R BS.1770 K-weighted level from 20 Hz to 20 kHz. The make-up gain is limited "
+                              "to -24 dB to +6 dB, so heavy cuts are only partly made up.");
+
     std::vector<juce::Component*> components = getComponents();
     for (auto* component : components)
     {
@@ -71,7 +76,7 @@ void SimpleEQ_SCAudioProcessorEditor::paint (juce::Graphics& g)
 
     for (size_t i = 0; i < magnitudes.size(); ++i)
     {
-        double magnitude = 1.f;
+        double magnitude = makeUpGain;
         auto freq = juce::mapToLog10<double>(double(i) / double(magnitudes.size()), 20, 20000);
 
         // get magnitude for frequency i as a product from all filters
@@ -114,6 +119,9 @@ void SimpleEQ_SCAudioProcessorEditor::resized()
     auto bounds = getLocalBounds();
     auto responseArea = bounds.removeFromTop(bounds.getHeight() * 0.33);
 
+    auto autoGainArea = bounds.removeFromBottom(30);
+    autoGainButton.setBounds(autoGainArea.withSizeKeepingCentre(100, autoGainArea.getHeight()));
+
     auto lowCutArea = bounds.removeFromLeft(bounds.getWidth() * 0.33);
     auto highCutArea = bounds.removeFromRight(bounds.getWidth() * 0.5);
 
@@ -152,6 +160,10 @@ void SimpleEQ_SCAudioProcessorEditor::timerCallback()
         auto highCutCoefficients = makeHighCutFilter(chainSettings, audioProcessor.getSampleRate());
         updateCutFilter(monoChain.get<ChainPositions::HighCut>(), highCutCoefficients, chainSettings.highCutSlope);
 
+        makeUpGain = chainSettings.autoGain
+            ? computeMakeUpGain(monoChain, makeAutoGainPoints(audioProcessor.getSampleRate()))
+            : 1.f;
+
         repaint();
 
     }
@@ -160,7 +172,7 @@ void SimpleEQ_SCAudioProcessorEditor::timerCallback()
 
 std::vector<juce::Component*> SimpleEQ_SCAudioProcessorEditor::getComponents()
 {
-    return { &peakFreqSlider, &peakGainSlider, &peakQSlider, &lowCutSlider, &highCutSlider, &lowCutSlopeSlider, &highCutSlopeSlider };
+    return { &peakFreqSlider, &peakGainSlider, &peakQSlider, &lowCutSlider, &highCutSlider, &lowCutSlopeSlider, &highCutSlopeSlider, &autoGainButton };
 }
 
 void SimpleEQ_SCAudioProcessorEditor::getMagForFreqCutFilters(CutFilter& cutFilter, double& magnitude, double& freq, const double& sampleRate)
@@ -54,10 +54,18 @@ private:
     Attachment peakFreqSliderAttachment, peakGainSliderAttachment, peakQSliderAttachment, 
         lowCutSliderAttachment, highCutSliderAttachment, lowCutSlopeSliderAttachment, highCutSlopeSliderAttachment;
 
+    juce::ToggleButton autoGainButton{ "Auto Gain" };
+    APVTS::ButtonAttachment autoGainButtonAttachment;
+
+    juce::TooltipWindow tooltipWindow{ this };
+
     std::vector<juce::Component*> getComponents();
 
     MonoChain monoChain;
 
+    // The gain the processor fuses into the last filter when auto gain is on.
+    float makeUpGain = 1.f;
+
     juce::Atomic<bool> parameterChanged = false;
 
     void getMagForFreqCutFilters(CutFilter& cutFilter, double& magnitude, double& freq, const double& sampleRate);
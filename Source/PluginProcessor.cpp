@@ -22,10 +22,24 @@ SimpleEQ_SCAudioProcessor::SimpleEQ_SCAudioProcessor()
                        )
 #endif
 {
+    // Registered with the APVTS rather than the parameters, so the flag is only set once
+    // the value that getChainSettings() reads has been updated.
+    const auto& params = getParameters();
+    for (auto* param : params)
+    {
+        if (auto* paramWithID = dynamic_cast<juce::AudioProcessorParameterWithID*>(param))
+            apvts.addParameterListener(paramWithID->paramID, this);
+    }
 }
 
 SimpleEQ_SCAudioProcessor::~SimpleEQ_SCAudioProcessor()
 {
+    const auto& params = getParameters();
+    for (auto* param : params)
+    {
+        if (auto* paramWithID = dynamic_cast<juce::AudioProcessorParameterWithID*>(param))
+            apvts.removeParameterListener(paramWithID->paramID, this);
+    }
 }
 
 //==============================================================================
@@ -101,10 +115,31 @@ void SimpleEQ_SCAudioProcessor::prepareToPlay (double sampleRate, int samplesPer
     spec.numChannels = 1;
     spec.sampleRate = sampleRate;
 
+    // Filters start out with a first-order default. Writing a biquad into every section
+    // before prepare() sizes the coefficient arrays and filter states for it here, so a
+    // later slope change doesn't reallocate either on the audio thread.
+    for (auto* chain : { &leftChain, &rightChain })
+    {
+        for (auto* cutFilter : { &chain->get<ChainPositions::LowCut>(), &chain->get<ChainPositions::HighCut>() })
+        {
+            updateCoefficients(cutFilter->get<0>().coefficients, {});
+            updateCoefficients(cutFilter->get<1>().coefficients, {});
+            updateCoefficients(cutFilter->get<2>().coefficients, {});
+            updateCoefficients(cutFilter->get<3>().coefficients, {});
+        }
+
+        updateCoefficients(chain->get<ChainPositions::Peak>().coefficients, {});
+    }
+
     leftChain.prepare(spec);
     rightChain.prepare(spec);
 
+    prepareAutoGain(sampleRate);
     updateFilters();
+
+    // Nothing is playing yet, so start at the make-up gain instead of ramping to it.
+    autoGain.setCurrentAndTargetValue(autoGain.getTargetValue());
+    applyAutoGain(autoGain.getCurrentValue());
 }
 
 void SimpleEQ_SCAudioProcessor::releaseResources()
@@ -141,6 +176,33 @@ bool SimpleEQ_SCAudioProcessor::isBusesLayoutSupported (const BusesLayout& layou
 
 void SimpleEQ_SCAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
+    // Coefficients are only redesigned after a parameter has actually moved.
+    if (parametersChanged.compareAndSetBool(false, true))
+        updateFilters();
+
+    const int numSamples = buffer.getNumSamples();
+
+    // While the make-up gain ramps, it is re-fused into the final filter stage every
+    // smallBlockSize samples.
+    if (autoGain.isSmoothing())
+    {
+        for (int startSample = 0; startSample < numSamples; startSample += smallBlockSize)
+        {
+            const int numToProcess = juce::jmin(smallBlockSize, numSamples - startSample);
+
+            applyAutoGain(autoGain.skip(numToProcess));
+            processSmallBlock(buffer, startSample, numToProcess);
+        }
+
+        return;
+    }
+
+    if (numSamples <= smallBlockSize)
+    {
+        processSmallBlock(buffer, 0, numSamples);
+        return;
+    }
+
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
@@ -154,8 +216,6 @@ void SimpleEQ_SCAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    updateFilters();
-
     juce::dsp::AudioBlock<float> block(buffer);
 
     auto leftBlock = block.getSingleChannelBlock(0);
@@ -168,6 +228,28 @@ void SimpleEQ_SCAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer,
     rightChain.process(rightContext);
 }
 
+void SimpleEQ_SCAudioProcessor::processSmallBlock(juce::AudioBuffer<float>& buffer, int startSample, int numSamples)
+{
+    // isBusesLayoutSupported() only accepts matching input and output layouts, so there
+    // are no extra output channels to clear here. Instead of ScopedNoDenormals, each
+    // filter snaps its state to zero at the end of the block.
+    const int numChannels = juce::jmin(buffer.getNumChannels(), 2);
+
+    for (int channel = 0; channel < numChannels; ++channel)
+    {
+        const auto& active = channel == 0 ? leftActiveFilters : rightActiveFilters;
+
+        // A view of the samples only, so nothing is allocated. Filter::process() runs a loop
+        // unrolled for biquads, which processSample() doesn't.
+        float* samples[] = { buffer.getWritePointer(channel, startSample) };
+        juce::dsp::AudioBlock<float> block(samples, 1, (size_t) numSamples);
+        juce::dsp::ProcessContextReplacing<float> context(block);
+
+        for (int i = 0; i < active.size; ++i)
+            active.filters[(size_t) i]->process(context);
+    }
+}
+
 //==============================================================================
 bool SimpleEQ_SCAudioProcessor::hasEditor() const
 {
@@ -190,8 +272,10 @@ void SimpleEQ_SCAudioProcessor::getStateInformation (juce::MemoryBlock& destData
     // You could do that either as raw data, or use the XML or ValueTree classes
     // as intermediaries to make it easy to save and load complex data.
 
+    // copyState() first flushes parameter changes that the APVTS timer hasn't written to
+    // the tree yet, so a value set just before this call is stored too.
     juce::MemoryOutputStream mos(destData, true);
-    apvts.state.writeToStream(mos);
+    apvts.copyState().writeToStream(mos);
 }
 
 void SimpleEQ_SCAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
@@ -203,7 +287,10 @@ void SimpleEQ_SCAudioProcessor::setStateInformation (const void* data, int sizeI
     if (tree.isValid())
     {
         apvts.replaceState(tree);
-        updateFilters();
+
+        // Called from the message thread, so the audio thread picks the change up
+        // on its next block rather than having its filters changed under it.
+        parametersChanged.set(true);
     }
 }
 
@@ -218,15 +305,30 @@ ChainSettings getChainSettings(const juce::AudioProcessorValueTreeState& apvts)
     settings.peakFreq = apvts.getRawParameterValue("Peak Freq")->load();
     settings.peakGainInDecibels = apvts.getRawParameterValue("Peak Gain")->load();
     settings.peakQ = apvts.getRawParameterValue("Peak Q")->load();
+    settings.autoGain = apvts.getRawParameterValue("Auto Gain")->load() > 0.5f;
 
     return settings;
 }
 
-//Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRate)
-//{
-//    return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, chainSettings.peakFreq,
-//        chainSettings.peakQ, juce::Decibels::decibelsToGain(chainSettings.peakGainInDecibels));
-//}
+void setChainSettings(juce::AudioProcessorValueTreeState& apvts, const ChainSettings& settings)
+{
+    auto setParameter = [&apvts](const juce::String& parameterID, float value)
+    {
+        auto* parameter = apvts.getParameter(parameterID);
+        parameter->setValueNotifyingHost(parameter->convertTo0to1(value));
+    };
+
+    setParameter("HighCut Freq", settings.highCutFreq);
+    setParameter("HighCut Slope", static_cast<float>(settings.highCutSlope));
+    setParameter("LowCut Freq", settings.lowCutFreq);
+    setParameter("LowCut Slope", static_cast<float>(settings.lowCutSlope));
+    setParameter("Peak Freq", settings.peakFreq);
+    setParameter("Peak Gain", settings.peakGainInDecibels);
+    setParameter("Peak Q", settings.peakQ);
+
+    // Auto gain is a user preference rather than part of the band settings (e.g. a
+    // reference match), so it is left untouched.
+}
 
 void SimpleEQ_SCAudioProcessor::updatePeakFilter(const ChainSettings& chainSettings)
 {
@@ -236,9 +338,22 @@ void SimpleEQ_SCAudioProcessor::updatePeakFilter(const ChainSettings& chainSetti
     updateCoefficients(rightChain.get<ChainPositions::Peak>().coefficients, peakCoefficients);
 }
 
-void updateCoefficients(Coefficients& oldCo, Coefficients& newCo)
+void updateCoefficients(Coefficients& oldCo, const FastFilterDesign::BiquadSection& newCo)
 {
-    *oldCo = *newCo;
+    // Writes straight into the existing coefficient array, so no Coefficients object
+    // is allocated on the audio thread. prepareToPlay makes every section a biquad, so
+    // the resize only ever happens there.
+    auto& raw = oldCo->coefficients;
+
+    if (raw.size() != 5)
+        raw.resize(5);
+
+    auto* c = raw.getRawDataPointer();
+    c[0] = newCo.b0;
+    c[1] = newCo.b1;
+    c[2] = newCo.b2;
+    c[3] = newCo.a1;
+    c[4] = newCo.a2;
 }
 
 void SimpleEQ_SCAudioProcessor::updateLowCutFilters(ChainSettings& chainSettings)
@@ -265,6 +380,30 @@ void SimpleEQ_SCAudioProcessor::updateHighCutFilters(ChainSettings& chainSetting
     updateCutFilter(rightHighCut, highCutCoefficients, chainSettings.highCutSlope);
 }
 
+static void collectActiveFilters(MonoChain& chain, std::array<Filter*, 9>& filters, int& numFilters)
+{
+    numFilters = 0;
+
+    auto addCutFilters = [&filters, &numFilters](CutFilter& cutFilter)
+    {
+        if (!cutFilter.isBypassed<0>())
+            filters[(size_t) numFilters++] = &cutFilter.get<0>();
+        if (!cutFilter.isBypassed<1>())
+            filters[(size_t) numFilters++] = &cutFilter.get<1>();
+        if (!cutFilter.isBypassed<2>())
+            filters[(size_t) numFilters++] = &cutFilter.get<2>();
+        if (!cutFilter.isBypassed<3>())
+            filters[(size_t) numFilters++] = &cutFilter.get<3>();
+    };
+
+    addCutFilters(chain.get<ChainPositions::LowCut>());
+
+    if (!chain.isBypassed<ChainPositions::Peak>())
+        filters[(size_t) numFilters++] = &chain.get<ChainPositions::Peak>();
+
+    addCutFilters(chain.get<ChainPositions::HighCut>());
+}
+
 void SimpleEQ_SCAudioProcessor::updateFilters()
 {
     ChainSettings chainSettings = getChainSettings(apvts);
@@ -272,6 +411,102 @@ void SimpleEQ_SCAudioProcessor::updateFilters()
     updatePeakFilter(chainSettings);
     updateLowCutFilters(chainSettings);
     updateHighCutFilters(chainSettings);
+
+    collectActiveFilters(leftChain, leftActiveFilters.filters, leftActiveFilters.size);
+    collectActiveFilters(rightChain, rightActiveFilters.filters, rightActiveFilters.size);
+
+    updateAutoGain(chainSettings);
+}
+
+AutoGainPoints makeAutoGainPoints(double sampleRate)
+{
+    // ITU-R BS.1770 K-weighting: a +4 dB high shelf and a 38 Hz highpass. The grid is
+    // log-spaced, so the integral in computeMakeUpGain assumes a pink programme spectrum.
+    AutoGainPoints points;
+
+    auto shelf = juce::dsp::IIR::Coefficients<double>::makeHighShelf(sampleRate, 1681.97, 0.70718,
+        juce::Decibels::decibelsToGain(4.0));
+    auto highPass = juce::dsp::IIR::Coefficients<double>::makeHighPass(sampleRate, 38.135, 0.50033);
+
+    const double maxFrequency = juce::jmin(20000.0, 0.45 * sampleRate);
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        auto frequency = juce::mapToLog10((double) i / double(points.size() - 1), 20.0, maxFrequency);
+        auto sine = std::sin(juce::MathConstants<double>::pi * frequency / sampleRate);
+        auto weight = shelf->getMagnitudeForFrequency(frequency, sampleRate)
+                    * highPass->getMagnitudeForFrequency(frequency, sampleRate);
+
+        points[i] = { sine * sine, weight * weight };
+    }
+
+    return points;
+}
+
+float computeMakeUpGain(MonoChain& chain, const AutoGainPoints& points)
+{
+    // Gain that brings the K-weighted power of the whole cascade back to unity.
+    std::array<Filter*, 9> filters;
+    int numFilters;
+    collectActiveFilters(chain, filters, numFilters);
+
+    double weightedPower = 0.0, totalWeight = 0.0;
+
+    for (const auto& point : points)
+    {
+        double magnitudeSquared = 1.0;
+
+        for (int i = 0; i < numFilters; ++i)
+        {
+            const auto* c = filters[(size_t) i]->coefficients->getRawCoefficients();
+            magnitudeSquared *= FastFilterDesign::getMagnitudeSquared({ c[0], c[1], c[2], c[3], c[4] }, point.phi);
+        }
+
+        weightedPower += point.weight * magnitudeSquared;
+        totalWeight += point.weight;
+    }
+
+    if (totalWeight == 0.0)
+        return 1.f;
+
+    const auto gain = std::sqrt(totalWeight / juce::jmax(weightedPower, 1.0e-12));
+
+    return (float) juce::jlimit(juce::Decibels::decibelsToGain((double) minMakeUpGainInDecibels),
+                                juce::Decibels::decibelsToGain((double) maxMakeUpGainInDecibels), gain);
+}
+
+void SimpleEQ_SCAudioProcessor::prepareAutoGain(double sampleRate)
+{
+    autoGainPoints = makeAutoGainPoints(sampleRate);
+    autoGain.reset(sampleRate, 0.05);
+}
+
+void SimpleEQ_SCAudioProcessor::updateAutoGain(const ChainSettings& chainSettings)
+{
+    // The filters have just been redesigned, so the final stage holds its unscaled numerator.
+    jassert(leftActiveFilters.size > 0);
+
+    const auto* numerator = leftActiveFilters.filters[(size_t) leftActiveFilters.size - 1]->coefficients->getRawCoefficients();
+    std::copy(numerator, numerator + 3, finalStageNumerator.begin());
+
+    autoGain.setTargetValue(chainSettings.autoGain ? computeMakeUpGain(leftChain, autoGainPoints) : 1.f);
+    applyAutoGain(autoGain.getCurrentValue());
+}
+
+void SimpleEQ_SCAudioProcessor::applyAutoGain(float gain)
+{
+    for (auto* active : { &leftActiveFilters, &rightActiveFilters })
+    {
+        auto* c = active->filters[(size_t) active->size - 1]->coefficients->getRawCoefficients();
+        c[0] = finalStageNumerator[0] * gain;
+        c[1] = finalStageNumerator[1] * gain;
+        c[2] = finalStageNumerator[2] * gain;
+    }
+}
+
+void SimpleEQ_SCAudioProcessor::parameterChanged(const juce::String& parameterID, float newValue)
+{
+    parametersChanged.set(true);
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout SimpleEQ_SCAudioProcessor::createParameterLayout()
@@ -307,6 +542,8 @@ juce::AudioProcessorValueTreeState::ParameterLayout SimpleEQ_SCAudioProcessor::c
 
     layout.add(std::make_unique<juce::AudioParameterChoice>("HighCut Slope", "HighCut Slope", stringArray, 0));
 
+    layout.add(std::make_unique<juce::AudioParameterBool>("Auto Gain", "Auto Gain", false));
+
     return layout;
 }
 
@@ -316,3 +553,506 @@ juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
 {
     return new SimpleEQ_SCAudioProcessor();
 }
+
+//==============================================================================
+#if JUCE_UNIT_TESTS
+
+class SmallBlockProcessingTests : public juce::UnitTest
+{
+public:
+    SmallBlockProcessingTests() : juce::UnitTest("Small block processing", "3BandEQ") {}
+
+    void runTest() override
+    {
+        constexpr double sampleRate = 48000.0;
+
+        beginTest("prepareToPlay makes every section a biquad");
+        {
+            // The default 12 dB/oct slopes only write the first section of each cut, so
+            // the other three are sized by prepareToPlay or not at all.
+            SimpleEQ_SCAudioProcessor processor;
+            processor.setRateAndBufferSizeDetails(sampleRate, 512);
+            processor.prepareToPlay(sampleRate, 512);
+
+            for (auto* chain : { &processor.leftChain, &processor.rightChain })
+            {
+                std::vector<Filter*> filters { &chain->get<ChainPositions::Peak>() };
+
+                for (auto* cutFilter : { &chain->get<ChainPositions::LowCut>(), &chain->get<ChainPositions::HighCut>() })
+                    filters.insert(filters.end(), { &cutFilter->get<0>(), &cutFilter->get<1>(),
+                                                    &cutFilter->get<2>(), &cutFilter->get<3>() });
+
+                for (auto* filter : filters)
+                    expectEquals((int) filter->coefficients->getFilterOrder(), 2);
+            }
+        }
+
+        for (auto blockSize : { 1, 8, 32 })
+        {
+            beginTest("Block size " + juce::String(blockSize));
+
+            SimpleEQ_SCAudioProcessor processor;
+            PreviousImplementation previous(processor);
+
+            // Every section active, so both paths do the most work they can.
+            ChainSettings settings;
+            settings.lowCutFreq = 80.f;
+            settings.lowCutSlope = Slope_48;
+            settings.highCutFreq = 12000.f;
+            settings.highCutSlope = Slope_48;
+            settings.peakFreq = 1000.f;
+            settings.peakGainInDecibels = 6.f;
+            settings.peakQ = 2.f;
+            setChainSettings(processor.apvts, settings);
+
+            processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+            processor.prepareToPlay(sampleRate, blockSize);
+            previous.prepare({ sampleRate, (juce::uint32) blockSize, 1 });
+
+            juce::AudioBuffer<float> buffer(2, blockSize), previousBuffer(2, blockSize);
+            juce::MidiBuffer midiMessages;
+            juce::Random random(0x3b);
+
+            float maxDifference = 0.f;
+
+            for (int call = 0; call < 8192 / blockSize; ++call)
+            {
+                for (int channel = 0; channel < 2; ++channel)
+                    for (int sample = 0; sample < blockSize; ++sample)
+                        buffer.setSample(channel, sample, random.nextFloat() * 2.f - 1.f);
+
+                previousBuffer.makeCopyOf(buffer);
+
+                processor.processBlock(buffer, midiMessages);
+                previous.process(previousBuffer);
+
+                for (int channel = 0; channel < 2; ++channel)
+                    for (int sample = 0; sample < blockSize; ++sample)
+                        maxDifference = juce::jmax(maxDifference,
+                            std::abs(buffer.getSample(channel, sample) - previousBuffer.getSample(channel, sample)));
+            }
+
+            // The baseline's float designs round differently from the fast design, which alone
+            // moves the output by about 2e-4 here.
+            expectLessThan(maxDifference, 1.0e-3f);
+
+            auto nanoseconds = getNanosecondsPerCall([&] { processor.processBlock(buffer, midiMessages); });
+            auto previousNanoseconds = getNanosecondsPerCall([&] { previous.process(previousBuffer); });
+
+            logMessage(juce::String::formatted("%2d samples: %.1f ns per call, previous implementation %.1f ns per call",
+                                               blockSize, nanoseconds, previousNanoseconds));
+
+            // Coarse on purpose, as timings are noisy: the previous implementation redesigns every
+            // section on each block, so even at 32 samples the new path is about twice as fast.
+            expectLessThan(nanoseconds, previousNanoseconds);
+        }
+    }
+
+private:
+    // processBlock() as it was before the fast coefficient design and the small block path,
+    // kept as the benchmark baseline: JUCE's float designs, which allocate new coefficients
+    // on every call, copied into the chains on every block.
+    struct PreviousImplementation
+    {
+        using CutCoefficients = juce::ReferenceCountedArray<juce::dsp::IIR::Coefficients<float>>;
+
+        explicit PreviousImplementation(SimpleEQ_SCAudioProcessor& p) : processor(p) {}
+
+        void prepare(const juce::dsp::ProcessSpec& spec)
+        {
+            leftChain.prepare(spec);
+            rightChain.prepare(spec);
+        }
+
+        void process(juce::AudioBuffer<float>& buffer)
+        {
+            juce::ScopedNoDenormals noDenormals;
+            auto totalNumInputChannels  = processor.getTotalNumInputChannels();
+            auto totalNumOutputChannels = processor.getTotalNumOutputChannels();
+
+            for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
+                buffer.clear (i, 0, buffer.getNumSamples());
+
+            auto chainSettings = getChainSettings(processor.apvts);
+            auto sampleRate = processor.getSampleRate();
+
+            auto peakCoefficients = juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, chainSettings.peakFreq,
+                chainSettings.peakQ, juce::Decibels::decibelsToGain(chainSettings.peakGainInDecibels));
+            updateCoefficients(leftChain.get<ChainPositions::Peak>().coefficients, peakCoefficients);
+            updateCoefficients(rightChain.get<ChainPositions::Peak>().coefficients, peakCoefficients);
+
+            auto lowCutCoefficients = juce::dsp::FilterDesign<float>::designIIRHighpassHighOrderButterworthMethod(chainSettings.lowCutFreq,
+                sampleRate, 2 * (chainSettings.lowCutSlope + 1));
+            updateCutFilter(leftChain.get<ChainPositions::LowCut>(), lowCutCoefficients, chainSettings.lowCutSlope);
+            updateCutFilter(rightChain.get<ChainPositions::LowCut>(), lowCutCoefficients, chainSettings.lowCutSlope);
+
+            auto highCutCoefficients = juce::dsp::FilterDesign<float>::designIIRLowpassHighOrderButterworthMethod(chainSettings.highCutFreq,
+                sampleRate, 2 * (chainSettings.highCutSlope + 1));
+            updateCutFilter(leftChain.get<ChainPositions::HighCut>(), highCutCoefficients, chainSettings.highCutSlope);
+            updateCutFilter(rightChain.get<ChainPositions::HighCut>(), highCutCoefficients, chainSettings.highCutSlope);
+
+            juce::dsp::AudioBlock<float> block(buffer);
+
+            auto leftBlock = block.getSingleChannelBlock(0);
+            auto rightBlock = block.getSingleChannelBlock(1);
+
+            juce::dsp::ProcessContextReplacing<float> leftContext(leftBlock);
+            juce::dsp::ProcessContextReplacing<float> rightContext(rightBlock);
+
+            leftChain.process(leftContext);
+            rightChain.process(rightContext);
+        }
+
+        static void updateCoefficients(Coefficients& oldCo, const Coefficients& newCo)
+        {
+            *oldCo = *newCo;
+        }
+
+        template<int Index>
+        static void update(CutFilter& chain, const CutCoefficients& coefficients)
+        {
+            updateCoefficients(chain.get<Index>().coefficients, coefficients[Index]);
+            chain.setBypassed<Index>(false);
+        }
+
+        static void updateCutFilter(CutFilter& cutFilter, const CutCoefficients& cutCoefficients, Slope cutFilterSlope)
+        {
+            cutFilter.setBypassed<0>(true);
+            cutFilter.setBypassed<1>(true);
+            cutFilter.setBypassed<2>(true);
+            cutFilter.setBypassed<3>(true);
+
+            switch (cutFilterSlope)
+            {
+            case Slope_48:
+            {
+                update<Slope_48>(cutFilter, cutCoefficients);
+                [[fallthrough]];
+            }
+            case Slope_36:
+            {
+                update<Slope_36>(cutFilter, cutCoefficients);
+                [[fallthrough]];
+            }
+            case Slope_24:
+            {
+                update<Slope_24>(cutFilter, cutCoefficients);
+                [[fallthrough]];
+            }
+            case Slope_12:
+            {
+                update<Slope_12>(cutFilter, cutCoefficients);
+                break;
+            }
+            }
+        }
+
+        SimpleEQ_SCAudioProcessor& processor;
+        MonoChain leftChain, rightChain;
+    };
+
+    template<typename Function>
+    static double getNanosecondsPerCall(Function&& function)
+    {
+        constexpr int numWarmUpCalls = 1000;
+        constexpr int numCalls = 100000;
+
+        for (int i = 0; i < numWarmUpCalls; ++i)
+            function();
+
+        auto start = juce::Time::getHighResolutionTicks();
+
+        for (int i = 0; i < numCalls; ++i)
+            function();
+
+        auto elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+        return elapsed * 1.0e9 / numCalls;
+    }
+};
+
+static SmallBlockProcessingTests smallBlockProcessingTests;
+
+//==============================================================================
+class AutoGainTests : public juce::UnitTest
+{
+public:
+    AutoGainTests() : juce::UnitTest("Auto gain", "3BandEQ") {}
+
+    void runTest() override
+    {
+        beginTest("Make-up gain is close to unity at the default settings");
+        {
+            SimpleEQ_SCAudioProcessor processor;
+            setAutoGain(processor, true);
+            prepare(processor);
+
+            // Only the default 20 Hz and 20 kHz cuts take a little level away.
+            expectWithinAbsoluteError(getMakeUpGainInDecibels(processor), 0.f, 0.25f);
+        }
+
+        beginTest("A +6 dB peak is compensated by its K-weighted level");
+        {
+            SimpleEQ_SCAudioProcessor processor;
+            setChainSettings(processor.apvts, getPeakSettings(6.f, 1.f));
+            setAutoGain(processor, true);
+            prepare(processor);
+
+            auto expected = getExpectedMakeUpGainInDecibels(getChainSettings(processor.apvts));
+            logMessage(juce::String::formatted("Make-up gain %.3f dB, expected %.3f dB", getMakeUpGainInDecibels(processor), expected));
+
+            // The processor integrates over 64 points, this over 2000.
+            expectLessThan((float) expected, -1.f);
+            expectWithinAbsoluteError(getMakeUpGainInDecibels(processor), (float) expected, 0.1f);
+        }
+
+        beginTest("Make-up gain is limited to -24 dB to +6 dB");
+        {
+            // Everything cut, which would need far more than +6 dB.
+            SimpleEQ_SCAudioProcessor processor;
+            ChainSettings settings = getPeakSettings(0.f, 1.f);
+            settings.lowCutFreq = 20000.f;
+            settings.lowCutSlope = Slope_48;
+            settings.highCutFreq = 20.f;
+            settings.highCutSlope = Slope_48;
+            setChainSettings(processor.apvts, settings);
+            setAutoGain(processor, true);
+            prepare(processor);
+
+            expectWithinAbsoluteError(getMakeUpGainInDecibels(processor), maxMakeUpGainInDecibels, 1.0e-3f);
+
+            // The widest, loudest peak. One band can't raise the average level by more than
+            // +24 dB, so the lower limit is never reached; the strongest boost stays above it.
+            setChainSettings(processor.apvts, getPeakSettings(24.f, 0.1f));
+            prepare(processor);
+
+            auto gainInDecibels = getMakeUpGainInDecibels(processor);
+            expectGreaterOrEqual(gainInDecibels, minMakeUpGainInDecibels);
+            expectLessThan(gainInDecibels, -12.f);
+        }
+
+        beginTest("A chain rebuilt from the settings gets the processor's make-up gain");
+        {
+            // This is how the editor's response curve includes the fused gain.
+            SimpleEQ_SCAudioProcessor processor;
+            ChainSettings settings = getPeakSettings(-9.f, 0.7f);
+            settings.lowCutFreq = 120.f;
+            settings.lowCutSlope = Slope_36;
+            settings.highCutFreq = 8000.f;
+            settings.highCutSlope = Slope_24;
+            setChainSettings(processor.apvts, settings);
+            setAutoGain(processor, true);
+            prepare(processor);
+
+            MonoChain chain;
+            updateCoefficients(chain.get<ChainPositions::Peak>().coefficients, makePeakFilter(settings, sampleRate));
+            updateCutFilter(chain.get<ChainPositions::LowCut>(), makeLowCutFilter(settings, sampleRate), settings.lowCutSlope);
+            updateCutFilter(chain.get<ChainPositions::HighCut>(), makeHighCutFilter(settings, sampleRate), settings.highCutSlope);
+
+            expectWithinAbsoluteError(juce::Decibels::gainToDecibels(computeMakeUpGain(chain, makeAutoGainPoints(sampleRate))),
+                                      getMakeUpGainInDecibels(processor), 1.0e-4f);
+        }
+
+        beginTest("Toggling auto gain ramps over 50 ms");
+        {
+            SimpleEQ_SCAudioProcessor processor;
+            setChainSettings(processor.apvts, getPeakSettings(6.f, 1.f));
+            prepare(processor);
+
+            expectWithinAbsoluteError(getFusedGainInDecibels(processor), 0.f, 1.0e-4f);
+
+            setAutoGain(processor, true);
+
+            juce::AudioBuffer<float> buffer(2, SimpleEQ_SCAudioProcessor::smallBlockSize);
+            juce::MidiBuffer midiMessages;
+
+            // The first block picks the change up and starts the ramp.
+            buffer.clear();
+            processor.processBlock(buffer, midiMessages);
+
+            const auto target = juce::Decibels::gainToDecibels(processor.autoGain.getTargetValue());
+            const auto rampLength = (int) (0.05 * sampleRate);
+
+            // Multiplicative smoothing moves by the same number of dB in every chunk.
+            const auto stepInDecibels = std::abs(target) * float(SimpleEQ_SCAudioProcessor::smallBlockSize) / float(rampLength);
+
+            auto previous = getFusedGainInDecibels(processor);
+            auto maxStep = std::abs(previous);
+            int numRampSamples = SimpleEQ_SCAudioProcessor::smallBlockSize;
+
+            while (processor.autoGain.isSmoothing() && numRampSamples < 2 * rampLength)
+            {
+                buffer.clear();
+                processor.processBlock(buffer, midiMessages);
+                numRampSamples += SimpleEQ_SCAudioProcessor::smallBlockSize;
+
+                auto current = getFusedGainInDecibels(processor);
+                maxStep = juce::jmax(maxStep, std::abs(current - previous));
+                previous = current;
+            }
+
+            expectEquals(numRampSamples, rampLength);
+            expectLessOrEqual(maxStep, stepInDecibels + 1.0e-3f);
+            expectWithinAbsoluteError(previous, target, 1.0e-4f);
+        }
+
+        beginTest("The final stage numerator follows a HighCut slope change");
+        {
+            SimpleEQ_SCAudioProcessor processor;
+            ChainSettings settings = getPeakSettings(6.f, 1.f);
+            settings.highCutFreq = 12000.f;
+            settings.highCutSlope = Slope_48;
+            setChainSettings(processor.apvts, settings);
+            setAutoGain(processor, true);
+            prepare(processor);
+
+            auto& highCut = processor.leftChain.get<ChainPositions::HighCut>();
+            expectFinalStageIs<3>(processor, settings);
+
+            // The last active stage moves from the fourth HighCut section to the first.
+            settings.highCutSlope = Slope_12;
+            setChainSettings(processor.apvts, settings);
+            processBlocks(processor, 4);
+
+            expect(highCut.isBypassed<3>());
+            expectFinalStageIs<0>(processor, settings);
+
+            // And back: the first section holds its unscaled design again.
+            settings.highCutSlope = Slope_48;
+            setChainSettings(processor.apvts, settings);
+            processBlocks(processor, 4);
+
+            expectFinalStageIs<3>(processor, settings);
+            expectNumerator(highCut.get<0>(), makeHighCutFilter(settings, sampleRate)[0], 1.f);
+        }
+    }
+
+private:
+    static constexpr double sampleRate = 48000.0;
+    static constexpr int blockSize = 512;
+
+    static ChainSettings getPeakSettings(float gainInDecibels, float Q)
+    {
+        ChainSettings settings;
+        settings.lowCutFreq = 20.f;
+        settings.highCutFreq = 20000.f;
+        settings.peakFreq = 1000.f;
+        settings.peakGainInDecibels = gainInDecibels;
+        settings.peakQ = Q;
+
+        return settings;
+    }
+
+    static void setAutoGain(SimpleEQ_SCAudioProcessor& processor, bool shouldBeOn)
+    {
+        processor.apvts.getParameter("Auto Gain")->setValueNotifyingHost(shouldBeOn ? 1.f : 0.f);
+    }
+
+    static void prepare(SimpleEQ_SCAudioProcessor& processor)
+    {
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+    }
+
+    static void processBlocks(SimpleEQ_SCAudioProcessor& processor, int numBlocks)
+    {
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        juce::MidiBuffer midiMessages;
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            buffer.clear();
+            processor.processBlock(buffer, midiMessages);
+        }
+    }
+
+    static float getMakeUpGainInDecibels(const SimpleEQ_SCAudioProcessor& processor)
+    {
+        return juce::Decibels::gainToDecibels(processor.autoGain.getTargetValue(), -100.f);
+    }
+
+    // The gain that is actually fused into the final stage's numerator.
+    static float getFusedGainInDecibels(const SimpleEQ_SCAudioProcessor& processor)
+    {
+        const auto& active = processor.leftActiveFilters;
+        const auto* c = active.filters[(size_t) active.size - 1]->coefficients->getRawCoefficients();
+
+        return juce::Decibels::gainToDecibels(c[0] / processor.finalStageNumerator[0], -100.f);
+    }
+
+    // Checks that the given HighCut section is the final stage of both chains, and that it
+    // holds its design's numerator scaled by the current make-up gain.
+    template<int Section>
+    void expectFinalStageIs(SimpleEQ_SCAudioProcessor& processor, const ChainSettings& settings)
+    {
+        const auto design = makeHighCutFilter(settings, sampleRate)[(size_t) Section];
+
+        expectWithinAbsoluteError(processor.finalStageNumerator[0], design.b0, 1.0e-7f);
+        expectWithinAbsoluteError(processor.finalStageNumerator[1], design.b1, 1.0e-7f);
+        expectWithinAbsoluteError(processor.finalStageNumerator[2], design.b2, 1.0e-7f);
+
+        auto& leftFilter = processor.leftChain.get<ChainPositions::HighCut>().get<Section>();
+        auto& rightFilter = processor.rightChain.get<ChainPositions::HighCut>().get<Section>();
+
+        expect(processor.leftActiveFilters.filters[(size_t) processor.leftActiveFilters.size - 1] == &leftFilter);
+        expect(processor.rightActiveFilters.filters[(size_t) processor.rightActiveFilters.size - 1] == &rightFilter);
+
+        expectNumerator(leftFilter, design, processor.autoGain.getCurrentValue());
+        expectNumerator(rightFilter, design, processor.autoGain.getCurrentValue());
+    }
+
+    void expectNumerator(const Filter& filter, const FastFilterDesign::BiquadSection& design, float gain)
+    {
+        const auto* c = filter.coefficients->getRawCoefficients();
+
+        expectWithinAbsoluteError(c[0], design.b0 * gain, 1.0e-6f * std::abs(design.b0 * gain) + 1.0e-9f);
+        expectWithinAbsoluteError(c[1], design.b1 * gain, 1.0e-6f * std::abs(design.b1 * gain) + 1.0e-9f);
+        expectWithinAbsoluteError(c[2], design.b2 * gain, 1.0e-6f * std::abs(design.b2 * gain) + 1.0e-9f);
+        expectWithinAbsoluteError(c[3], design.a1, 1.0e-6f);
+        expectWithinAbsoluteError(c[4], design.a2, 1.0e-6f);
+    }
+
+    // BS.1770 K-weighted level change of the cascade for pink noise, from double-precision
+    // JUCE designs on a fine grid, independently of the processor's own integration.
+    static double getExpectedMakeUpGainInDecibels(const ChainSettings& settings)
+    {
+        using DoubleCoefficients = juce::dsp::IIR::Coefficients<double>;
+
+        auto shelf = DoubleCoefficients::makeHighShelf(sampleRate, 1681.97, 0.70718, juce::Decibels::decibelsToGain(4.0));
+        auto highPass = DoubleCoefficients::makeHighPass(sampleRate, 38.135, 0.50033);
+
+        juce::ReferenceCountedArray<DoubleCoefficients> sections;
+        sections.addArray(juce::dsp::FilterDesign<double>::designIIRHighpassHighOrderButterworthMethod(settings.lowCutFreq,
+            sampleRate, 2 * (settings.lowCutSlope + 1)));
+        sections.add(DoubleCoefficients::makePeakFilter(sampleRate, settings.peakFreq, settings.peakQ,
+            juce::Decibels::decibelsToGain((double) settings.peakGainInDecibels)));
+        sections.addArray(juce::dsp::FilterDesign<double>::designIIRLowpassHighOrderButterworthMethod(settings.highCutFreq,
+            sampleRate, 2 * (settings.highCutSlope + 1)));
+
+        constexpr int numPoints = 2000;
+        const double maxFrequency = juce::jmin(20000.0, 0.45 * sampleRate);
+
+        double weightedPower = 0.0, totalWeight = 0.0;
+
+        for (int i = 0; i < numPoints; ++i)
+        {
+            auto frequency = juce::mapToLog10((double) i / double(numPoints - 1), 20.0, maxFrequency);
+            auto weight = juce::square(shelf->getMagnitudeForFrequency(frequency, sampleRate)
+                                       * highPass->getMagnitudeForFrequency(frequency, sampleRate));
+
+            double magnitude = 1.0;
+
+            for (auto* section : sections)
+                magnitude *= section->getMagnitudeForFrequency(frequency, sampleRate);
+
+            weightedPower += weight * magnitude * magnitude;
+            totalWeight += weight;
+        }
+
+        return juce::Decibels::gainToDecibels(std::sqrt(totalWeight / weightedPower));
+    }
+};
+
+static AutoGainTests autoGainTests;
+
+#endif
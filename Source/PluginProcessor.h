@@ -9,6 +9,7 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "FastFilterDesign.h"
 
 enum Slope
 {
@@ -20,9 +21,11 @@ struct ChainSettings
     float peakFreq = 0.f, peakGainInDecibels = 0.f, peakQ = 1.f;
     float lowCutFreq = 0.f, highCutFreq = 0.f;
     Slope lowCutSlope = Slope::Slope_12, highCutSlope = Slope::Slope_12;
+    bool autoGain = false;
 };
 
 ChainSettings getChainSettings(const juce::AudioProcessorValueTreeState& apvts);
+void setChainSettings(juce::AudioProcessorValueTreeState& apvts, const ChainSettings& settings);
 
 using Filter = juce::dsp::IIR::Filter<float>;
 using CutFilter = juce::dsp::ProcessorChain<Filter, Filter, Filter, Filter>;
@@ -37,6 +40,7 @@ enum ChainPositions
 
 using Coefficients = Filter::CoefficientsPtr;
 
+void updateCoefficients(Coefficients& oldCo, const FastFilterDesign::BiquadSection& newCo);
 
 template<int Index, typename ChainType, typename CoefficientType>
 void update(ChainType& chain, const CoefficientType& coefficients)
@@ -58,17 +62,17 @@ void updateCutFilter(ChainType& cutFilter, const CoefficientType& cutCoefficient
     case Slope_48:
     {
         update<Slope_48>(cutFilter, cutCoefficients);
-        __fallthrough;
+        [[fallthrough]];
     }
     case Slope_36:
     {
         update<Slope_36>(cutFilter, cutCoefficients);
-        __fallthrough;
+        [[fallthrough]];
     }
     case Slope_24:
     {
         update<Slope_24>(cutFilter, cutCoefficients);
-        __fallthrough;
+        [[fallthrough]];
     }
     case Slope_12:
     {
@@ -78,29 +82,49 @@ void updateCutFilter(ChainType& cutFilter, const CoefficientType& cutCoefficient
     }
 }
 
-void updateCoefficients(Coefficients& oldCo, Coefficients& newCo);
-
-inline Coefficients makePeakFilter(const ChainSettings& chainSettings, double sampleRate)
+inline FastFilterDesign::BiquadSection makePeakFilter(const ChainSettings& chainSettings, double sampleRate)
 {
-    return juce::dsp::IIR::Coefficients<float>::makePeakFilter(sampleRate, chainSettings.peakFreq,
-        chainSettings.peakQ, juce::Decibels::decibelsToGain(chainSettings.peakGainInDecibels));
+    return FastFilterDesign::designPeakSection(chainSettings.peakFreq, chainSettings.peakQ,
+        chainSettings.peakGainInDecibels, sampleRate);
 }
 
 inline auto makeLowCutFilter(const ChainSettings& chainSettings, double sampleRate)
 {
-    return juce::dsp::FilterDesign<float>::designIIRHighpassHighOrderButterworthMethod(chainSettings.lowCutFreq,
-       sampleRate, 2 * (chainSettings.lowCutSlope + 1));
+    return FastFilterDesign::designCutSections(chainSettings.lowCutFreq, sampleRate,
+        2 * (chainSettings.lowCutSlope + 1), true);
 }
 inline auto makeHighCutFilter(const ChainSettings& chainSettings, double sampleRate)
 {
-    return juce::dsp::FilterDesign<float>::designIIRLowpassHighOrderButterworthMethod(chainSettings.highCutFreq,
-        sampleRate, 2 * (chainSettings.highCutSlope + 1));
+    return FastFilterDesign::designCutSections(chainSettings.highCutFreq, sampleRate,
+        2 * (chainSettings.highCutSlope + 1), false);
 }
 
+// Auto gain keeps the loudness of pink noise through the EQ equal to the dry level, with
+// loudness measured as ITU-R BS.1770 K-weighted power between 20 Hz and 20 kHz.
+struct AutoGainPoint
+{
+    double phi;    // sin^2 (omega / 2)
+    double weight; // K-weighting power
+};
+
+using AutoGainPoints = std::array<AutoGainPoint, 64>;
+
+AutoGainPoints makeAutoGainPoints(double sampleRate);
+
+// Attenuation is always safe. Boosting a heavily cut signal back to full loudness would
+// mostly raise what is left at the band edges and risk clipping, so boosts stop at +6 dB.
+constexpr float minMakeUpGainInDecibels = -24.f;
+constexpr float maxMakeUpGainInDecibels = 6.f;
+
+// Make-up gain for the non-bypassed filters of a chain, which must hold their unscaled
+// designs. Shared by the processor and the editor's response curve.
+float computeMakeUpGain(MonoChain& chain, const AutoGainPoints& points);
+
 //==============================================================================
 /**
 */
-class SimpleEQ_SCAudioProcessor  : public juce::AudioProcessor
+class SimpleEQ_SCAudioProcessor  : public juce::AudioProcessor,
+                                          juce::AudioProcessorValueTreeState::Listener
 {
 public:
     //==============================================================================
@@ -140,13 +164,45 @@ public:
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
+    void parameterChanged(const juce::String& parameterID, float newValue) override;
+
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
     juce::AudioProcessorValueTreeState apvts{ *this, nullptr, "Parameters", createParameterLayout() };
 
 private:
+    friend class AutoGainTests;
+    friend class SmallBlockProcessingTests;
+
     MonoChain leftChain, rightChain;
 
+    // Blocks up to this size skip the ProcessorChain and its bypass checks and run the
+    // active filters directly.
+    static constexpr int smallBlockSize = 32;
+
+    // The non-bypassed filters of a chain in processing order, rebuilt in updateFilters().
+    struct ActiveFilters
+    {
+        std::array<Filter*, 9> filters;
+        int size = 0;
+    };
+
+    ActiveFilters leftActiveFilters, rightActiveFilters;
+
+    juce::Atomic<bool> parametersChanged = true;
+
+    // Auto gain: the make-up gain is computed from the coefficients whenever they change
+    // and fused into the numerator of the last active filter, so it costs nothing per sample.
+    AutoGainPoints autoGainPoints{};
+    std::array<float, 3> finalStageNumerator{ 1.f, 0.f, 0.f };
+    juce::SmoothedValue<float, juce::ValueSmoothingTypes::Multiplicative> autoGain;
+
+    void prepareAutoGain(double sampleRate);
+    void updateAutoGain(const ChainSettings& chainSettings);
+    void applyAutoGain(float gain);
+
+    void processSmallBlock(juce::AudioBuffer<float>& buffer, int startSample, int numSamples);
+
     void updatePeakFilter(const ChainSettings& chainSettings);
 
     void updateLowCutFilters(ChainSettings& chainSettings);
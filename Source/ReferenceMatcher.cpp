@@ -0,0 +1,665 @@
+/*
+  ==============================================================================
+
+    Fits the band settings so that a target file, run through the EQ, matches
+    the long-term average spectrum of a reference file.
+
+  ==============================================================================
+*/
+
+#include "ReferenceMatcher.h"
+
+namespace
+{
+    constexpr int fftOrder = 13;
+    constexpr int fftSize = 1 << fftOrder;
+    constexpr int hopSize = fftSize / 2; // 50% overlap with a Hann window
+    constexpr size_t numBins = fftSize / 2 + 1;
+
+    // The difference curve is compared on a 1/12 octave grid.
+    const double bandRatio = std::pow(2.0, 1.0 / 12.0);
+
+    // Bands more than this far below the loudest band of either file are ignored. Further
+    // down a steep low cut, leakage through the Hann window outweighs the actual level.
+    constexpr double dynamicRangeInDecibels = 60.0;
+
+    juce::int64 getNumFrames(juce::int64 lengthInSamples)
+    {
+        // Files shorter than one FFT are zero-padded to a single frame.
+        if (lengthInSamples <= fftSize)
+            return 1;
+
+        return (lengthInSamples - fftSize) / hopSize + 1;
+    }
+
+    double getBandLevelInDecibels(const std::vector<double>& power, double sampleRate, double frequency)
+    {
+        const double binWidth = sampleRate / fftSize;
+        const double halfBand = std::sqrt(bandRatio);
+
+        auto firstBin = (size_t) std::ceil(frequency / halfBand / binWidth);
+        auto lastBin = juce::jmin(numBins - 1, (size_t) std::floor(frequency * halfBand / binWidth));
+
+        // At low frequencies a band can fall between two bins; use the nearest one then.
+        if (firstBin > lastBin)
+            firstBin = lastBin = juce::jmin(numBins - 1, (size_t) std::round(frequency / binWidth));
+
+        double sum = 0.0;
+
+        for (auto bin = firstBin; bin <= lastBin; ++bin)
+            sum += power[bin];
+
+        return 10.0 * std::log10(juce::jmax(sum / double(lastBin - firstBin + 1), 1.0e-30));
+    }
+
+    enum FitParameter
+    {
+        LowCutFrequency, HighCutFrequency, PeakFrequency, PeakGain, PeakQ, NumFitParameters
+    };
+
+    // Frequencies and Q are searched in octaves, gain in dB.
+    using FitParameters = std::array<double, NumFitParameters>;
+
+    ChainSettings toChainSettings(const FitParameters& parameters, int lowCutSlope, int highCutSlope)
+    {
+        ChainSettings settings;
+
+        settings.lowCutFreq = (float) std::exp2(parameters[LowCutFrequency]);
+        settings.highCutFreq = (float) std::exp2(parameters[HighCutFrequency]);
+        settings.peakFreq = (float) std::exp2(parameters[PeakFrequency]);
+        settings.peakGainInDecibels = (float) parameters[PeakGain];
+        settings.peakQ = (float) std::exp2(parameters[PeakQ]);
+        settings.lowCutSlope = static_cast<Slope>(lowCutSlope);
+        settings.highCutSlope = static_cast<Slope>(highCutSlope);
+
+        return settings;
+    }
+}
+
+//==============================================================================
+class ReferenceMatcher::SpectrumJob : public juce::ThreadPoolJob
+{
+public:
+    SpectrumJob(juce::AudioFormatManager& manager, const juce::File& fileToAnalyse, juce::int64 first, juce::int64 count)
+        : juce::ThreadPoolJob("Reference matching"), formatManager(manager), file(fileToAnalyse),
+          firstFrame(first), numFrames(count), fft(fftOrder),
+          window(fftSize, juce::dsp::WindowingFunction<float>::hann, false)
+    {
+    }
+
+    JobStatus runJob() override
+    {
+        // Each job opens its own reader, as readers can't be shared between threads.
+        std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+        if (reader == nullptr)
+        {
+            failed = true;
+            return jobHasFinished;
+        }
+
+        const int numChannels = (int) reader->numChannels;
+
+        juce::AudioBuffer<float> frame(numChannels, fftSize);
+        std::vector<float> fftData(2 * fftSize);
+        power.assign(numBins, 0.0);
+
+        auto readPosition = firstFrame * hopSize;
+
+        for (juce::int64 i = 0; i < numFrames; ++i)
+        {
+            if (shouldExit())
+            {
+                failed = true;
+                return jobHasFinished;
+            }
+
+            // Only the next hop is read; the overlapping half is kept from the last frame.
+            if (i == 0)
+            {
+                reader->read(&frame, 0, fftSize, readPosition, true, true);
+                readPosition += fftSize;
+            }
+            else
+            {
+                for (int channel = 0; channel < numChannels; ++channel)
+                    std::memmove(frame.getWritePointer(channel), frame.getReadPointer(channel, hopSize), hopSize * sizeof(float));
+
+                reader->read(&frame, hopSize, hopSize, readPosition, true, true);
+                readPosition += hopSize;
+            }
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                std::copy(frame.getReadPointer(channel), frame.getReadPointer(channel) + fftSize, fftData.begin());
+
+                window.multiplyWithWindowingTable(fftData.data(), fftSize);
+                fft.performFrequencyOnlyForwardTransform(fftData.data());
+
+                for (size_t bin = 0; bin < numBins; ++bin)
+                    power[bin] += double(fftData[bin]) * double(fftData[bin]);
+            }
+        }
+
+        numSpectra = double(numFrames * numChannels);
+
+        return jobHasFinished;
+    }
+
+    const std::vector<double>& getPower() const { return power; }
+    double getNumSpectra() const { return numSpectra; }
+    bool hasFailed() const { return failed; }
+
+private:
+    juce::AudioFormatManager& formatManager;
+    juce::File file;
+    juce::int64 firstFrame, numFrames;
+
+    juce::dsp::FFT fft;
+    juce::dsp::WindowingFunction<float> window;
+
+    std::vector<double> power;
+    double numSpectra = 0.0;
+    bool failed = false;
+};
+
+//==============================================================================
+ReferenceMatcher::ReferenceMatcher(int numThreads)
+    : threadPool(numThreads)
+{
+    formatManager.registerBasicFormats();
+}
+
+ReferenceMatcher::~ReferenceMatcher()
+{
+}
+
+juce::Result ReferenceMatcher::match(const juce::File& referenceFile, const juce::File& targetFile, ChainSettings& settings)
+{
+    juce::OwnedArray<SpectrumJob> referenceJobs, targetJobs;
+    double referenceSampleRate = 0.0, targetSampleRate = 0.0;
+
+    // Both files are queued before waiting, so they are analysed at the same time.
+    auto result = analyse(referenceFile, referenceJobs, referenceSampleRate);
+
+    if (result.wasOk())
+        result = analyse(targetFile, targetJobs, targetSampleRate);
+
+    auto reference = collect(referenceJobs, referenceSampleRate);
+    auto target = collect(targetJobs, targetSampleRate);
+
+    if (result.failed())
+        return result;
+
+    if (reference.power.empty() || target.power.empty())
+        return juce::Result::fail("Analysis was interrupted or a file could not be read");
+
+    // The EQ will run on the target material, so the fit uses its sample rate.
+    settings = fit(makeFitPoints(reference, target), targetSampleRate);
+
+    return juce::Result::ok();
+}
+
+juce::Result ReferenceMatcher::analyse(const juce::File& file, juce::OwnedArray<SpectrumJob>& jobs, double& sampleRate)
+{
+    std::unique_ptr<juce::AudioFormatReader> reader(formatManager.createReaderFor(file));
+
+    if (reader == nullptr)
+        return juce::Result::fail("Unable to read " + file.getFullPathName());
+
+    sampleRate = reader->sampleRate;
+
+    // Segments start on a frame boundary, so the result is the same as a single pass.
+    const auto totalFrames = getNumFrames(reader->lengthInSamples);
+    const auto numSegments = juce::jlimit<juce::int64>(1, threadPool.getNumThreads(), totalFrames);
+
+    for (juce::int64 segment = 0; segment < numSegments; ++segment)
+    {
+        auto firstFrame = totalFrames * segment / numSegments;
+        auto endFrame = totalFrames * (segment + 1) / numSegments;
+
+        auto* job = jobs.add(new SpectrumJob(formatManager, file, firstFrame, endFrame - firstFrame));
+        threadPool.addJob(job, false);
+    }
+
+    return juce::Result::ok();
+}
+
+ReferenceMatcher::LongTermSpectrum ReferenceMatcher::collect(juce::OwnedArray<SpectrumJob>& jobs, double sampleRate)
+{
+    LongTermSpectrum spectrum;
+    std::vector<double> power(numBins, 0.0);
+    double numSpectra = 0.0;
+    bool failed = jobs.isEmpty();
+
+    for (auto* job : jobs)
+    {
+        threadPool.waitForJobToFinish(job, -1);
+
+        if (job->hasFailed())
+        {
+            failed = true;
+            continue;
+        }
+
+        for (size_t bin = 0; bin < numBins; ++bin)
+            power[bin] += job->getPower()[bin];
+
+        numSpectra += job->getNumSpectra();
+    }
+
+    if (failed || numSpectra == 0.0)
+        return spectrum;
+
+    for (auto& binPower : power)
+        binPower /= numSpectra;
+
+    spectrum.power = std::move(power);
+    spectrum.sampleRate = sampleRate;
+
+    return spectrum;
+}
+
+std::vector<ReferenceMatcher::FitPoint> ReferenceMatcher::makeFitPoints(const LongTermSpectrum& reference, const LongTermSpectrum& target)
+{
+    const double maxFrequency = juce::jmin(20000.0, 0.45 * juce::jmin(reference.sampleRate, target.sampleRate));
+
+    std::vector<FitPoint> points;
+    std::vector<double> referenceLevels, targetLevels;
+
+    for (double frequency = 20.0; frequency <= maxFrequency; frequency *= bandRatio)
+    {
+        auto phi = std::sin(juce::MathConstants<double>::pi * frequency / target.sampleRate);
+
+        points.push_back({ frequency, phi * phi, 0.0, 0.0 });
+        referenceLevels.push_back(getBandLevelInDecibels(reference.power, reference.sampleRate, frequency));
+        targetLevels.push_back(getBandLevelInDecibels(target.power, target.sampleRate, frequency));
+    }
+
+    if (points.empty())
+        return points;
+
+    const auto referenceFloor = *std::max_element(referenceLevels.begin(), referenceLevels.end()) - dynamicRangeInDecibels;
+    const auto targetFloor = *std::max_element(targetLevels.begin(), targetLevels.end()) - dynamicRangeInDecibels;
+
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        points[i].differenceInDecibels = referenceLevels[i] - targetLevels[i];
+
+        if (referenceLevels[i] > referenceFloor && targetLevels[i] > targetFloor)
+            points[i].weight = 1.0;
+    }
+
+    return points;
+}
+
+ChainSettings ReferenceMatcher::fit(const std::vector<FitPoint>& points, double sampleRate)
+{
+    constexpr int maxIterations = 1000;
+
+    const FitParameters lowerLimits { std::log2(20.0), std::log2(20.0), std::log2(20.0), -24.0, std::log2(0.1) };
+    const FitParameters upperLimits { std::log2(20000.0), std::log2(20000.0), std::log2(20000.0), 24.0, std::log2(10.0) };
+    const FitParameters minimumSteps { 1.0 / 48.0, 1.0 / 48.0, 1.0 / 48.0, 0.05, 1.0 / 48.0 };
+
+    std::vector<double> deviations(points.size());
+
+    // Pattern search over the first numParameters parameters: move one parameter at a time
+    // while that helps, then halve the steps. Returns the error it ends on.
+    auto search = [&](FitParameters& parameters, size_t numParameters, int lowCutSlope, int highCutSlope)
+    {
+        FitParameters steps { 1.0, 1.0, 1.0, 3.0, 1.0 };
+        auto bestError = getFitError(points, toChainSettings(parameters, lowCutSlope, highCutSlope), sampleRate, deviations);
+
+        for (int iteration = 0; iteration < maxIterations; ++iteration)
+        {
+            bool improved = false;
+
+            for (size_t p = 0; p < numParameters; ++p)
+            {
+                for (auto direction : { -1.0, 1.0 })
+                {
+                    auto candidate = parameters;
+                    candidate[p] = juce::jlimit(lowerLimits[p], upperLimits[p], parameters[p] + direction * steps[p]);
+
+                    auto error = getFitError(points, toChainSettings(candidate, lowCutSlope, highCutSlope), sampleRate, deviations);
+
+                    if (error < bestError)
+                    {
+                        bestError = error;
+                        parameters = candidate;
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+
+            if (! improved)
+            {
+                bool converged = true;
+
+                for (size_t p = 0; p < numParameters; ++p)
+                {
+                    steps[p] *= 0.5;
+                    converged = converged && steps[p] < minimumSteps[p];
+                }
+
+                if (converged)
+                    break;
+            }
+        }
+
+        return bestError;
+    };
+
+    ChainSettings bestSettings;
+    auto bestError = std::numeric_limits<double>::max();
+
+    // A cut frequency and its slope trade off against each other, so a search that changes the
+    // slope on the way settles on the first one that roughly fits. Each combination is searched
+    // on its own instead.
+    for (int lowCutSlope = Slope_12; lowCutSlope <= Slope_48; ++lowCutSlope)
+    {
+        for (int highCutSlope = Slope_12; highCutSlope <= Slope_48; ++highCutSlope)
+        {
+            // The cuts are fitted with the peak flat first. The peak is then started from every
+            // octave in turn with the gain left over there, as the largest single deviation is
+            // usually on the edge of a cut rather than at the peak.
+            FitParameters cutParameters { lowerLimits[LowCutFrequency], upperLimits[HighCutFrequency], std::log2(1000.0), 0.0, 0.0 };
+            search(cutParameters, PeakFrequency, lowCutSlope, highCutSlope);
+
+            getFitError(points, toChainSettings(cutParameters, lowCutSlope, highCutSlope), sampleRate, deviations);
+            const auto cutDeviations = deviations;
+
+            for (double peakFrequency = 40.0; peakFrequency <= 16000.0; peakFrequency *= 2.0)
+            {
+                auto parameters = cutParameters;
+                parameters[PeakFrequency] = std::log2(peakFrequency);
+
+                double closestDistance = std::numeric_limits<double>::max();
+
+                for (size_t i = 0; i < points.size(); ++i)
+                {
+                    auto distance = std::abs(std::log2(points[i].frequency / peakFrequency));
+
+                    if (points[i].weight > 0.0 && distance < closestDistance)
+                    {
+                        closestDistance = distance;
+                        parameters[PeakGain] = juce::jlimit(-24.0, 24.0, -cutDeviations[i]);
+                    }
+                }
+
+                auto error = search(parameters, NumFitParameters, lowCutSlope, highCutSlope);
+
+                if (error < bestError)
+                {
+                    bestError = error;
+                    bestSettings = toChainSettings(parameters, lowCutSlope, highCutSlope);
+                }
+            }
+        }
+    }
+
+    return bestSettings;
+}
+
+double ReferenceMatcher::getFitError(const std::vector<FitPoint>& points, const ChainSettings& settings, double sampleRate,
+                                     std::vector<double>& deviations)
+{
+    const auto peak = makePeakFilter(settings, sampleRate);
+    const auto lowCut = makeLowCutFilter(settings, sampleRate);
+    const auto highCut = makeHighCutFilter(settings, sampleRate);
+
+    const int numLowCutSections = settings.lowCutSlope + 1;
+    const int numHighCutSections = settings.highCutSlope + 1;
+
+    double totalWeight = 0.0, meanDeviation = 0.0;
+
+    for (size_t p = 0; p < points.size(); ++p)
+    {
+        auto& point = points[p];
+        deviations[p] = 0.0;
+
+        if (point.weight == 0.0)
+            continue;
+
+        auto magnitudeSquared = FastFilterDesign::getMagnitudeSquared(peak, point.phi);
+
+        for (int i = 0; i < numLowCutSections; ++i)
+            magnitudeSquared *= FastFilterDesign::getMagnitudeSquared(lowCut[(size_t) i], point.phi);
+
+        for (int i = 0; i < numHighCutSections; ++i)
+            magnitudeSquared *= FastFilterDesign::getMagnitudeSquared(highCut[(size_t) i], point.phi);
+
+        deviations[p] = 10.0 * std::log10(juce::jmax(magnitudeSquared, 1.0e-30)) - point.differenceInDecibels;
+
+        totalWeight += point.weight;
+        meanDeviation += point.weight * deviations[p];
+    }
+
+    if (totalWeight == 0.0)
+        return 0.0;
+
+    // The EQ has no output gain, so the overall level difference between the files is not
+    // part of the fit: deviations are measured around the level offset that fits best.
+    meanDeviation /= totalWeight;
+
+    double error = 0.0;
+
+    for (size_t p = 0; p < points.size(); ++p)
+    {
+        if (points[p].weight == 0.0)
+            continue;
+
+        deviations[p] -= meanDeviation;
+        error += points[p].weight * deviations[p] * deviations[p];
+    }
+
+    return error;
+}
+
+//==============================================================================
+#if JUCE_UNIT_TESTS
+
+class ReferenceMatcherTests : public juce::UnitTest
+{
+public:
+    ReferenceMatcherTests() : juce::UnitTest("ReferenceMatcher", "3BandEQ") {}
+
+    void runTest() override
+    {
+        ChainSettings known;
+        known.lowCutFreq = 100.f;
+        known.lowCutSlope = Slope_24;
+        known.highCutFreq = 8000.f;
+        known.highCutSlope = Slope_36;
+        known.peakFreq = 1000.f;
+        known.peakGainInDecibels = 6.f;
+        known.peakQ = 1.5f;
+
+        juce::TemporaryFile referenceFile(".wav"), targetFile(".wav");
+
+        beginTest("Writing white noise and the same noise through the EQ");
+        expect(writeTestFiles(referenceFile.getFile(), targetFile.getFile(), known, 10.0));
+
+        beginTest("Segmented analysis matches a single pass");
+        {
+            ReferenceMatcher singlePass(1), segmented(4);
+
+            auto single = analyse(singlePass, targetFile.getFile());
+            auto segments = analyse(segmented, targetFile.getFile());
+
+            expectEquals((int) segments.power.size(), (int) single.power.size());
+            expect(! single.power.empty());
+
+            double maxRelativeDifference = 0.0;
+
+            for (size_t bin = 0; bin < juce::jmin(single.power.size(), segments.power.size()); ++bin)
+                maxRelativeDifference = juce::jmax(maxRelativeDifference,
+                    std::abs(segments.power[bin] - single.power[bin]) / juce::jmax(single.power[bin], 1.0e-30));
+
+            // Only the order in which the segments are summed differs.
+            expectLessThan(maxRelativeDifference, 1.0e-9);
+        }
+
+        ChainSettings matched;
+
+        beginTest("Known settings are recovered");
+        {
+            ReferenceMatcher matcher;
+
+            auto result = matcher.match(referenceFile.getFile(), targetFile.getFile(), matched);
+            expect(result.wasOk(), result.getErrorMessage());
+
+            logMessage(toString(matched));
+
+            // Frequencies and Q in octaves, gain in dB.
+            expectLessThan(getOctaves(matched.lowCutFreq, known.lowCutFreq), 1.0 / 6.0);
+            expectLessThan(getOctaves(matched.highCutFreq, known.highCutFreq), 1.0 / 6.0);
+            expectEquals((int) matched.lowCutSlope, (int) known.lowCutSlope);
+            expectEquals((int) matched.highCutSlope, (int) known.highCutSlope);
+
+            expectLessThan(getOctaves(matched.peakFreq, known.peakFreq), 1.0 / 6.0);
+            expectLessThan(std::abs(matched.peakGainInDecibels - known.peakGainInDecibels), 1.f);
+            expectLessThan(getOctaves(matched.peakQ, known.peakQ), 1.0 / 3.0);
+        }
+
+        beginTest("Matched settings are stored in the plugin state");
+        {
+            // As the console's --match writes them: set on a fresh processor and stored
+            // straight away, before any timer has run.
+            juce::MemoryBlock state;
+            {
+                SimpleEQ_SCAudioProcessor processor;
+                setChainSettings(processor.apvts, matched);
+                processor.getStateInformation(state);
+            }
+
+            SimpleEQ_SCAudioProcessor loaded;
+            loaded.setStateInformation(state.getData(), (int) state.getSize());
+            auto restored = getChainSettings(loaded.apvts);
+
+            // Within the parameters' step sizes: 1 Hz, 0.5 dB and 0.05.
+            expectWithinAbsoluteError(restored.lowCutFreq, matched.lowCutFreq, 0.5f);
+            expectWithinAbsoluteError(restored.highCutFreq, matched.highCutFreq, 0.5f);
+            expectWithinAbsoluteError(restored.peakFreq, matched.peakFreq, 0.5f);
+            expectWithinAbsoluteError(restored.peakGainInDecibels, matched.peakGainInDecibels, 0.25f);
+            expectWithinAbsoluteError(restored.peakQ, matched.peakQ, 0.025f);
+            expectEquals((int) restored.lowCutSlope, (int) matched.lowCutSlope);
+            expectEquals((int) restored.highCutSlope, (int) matched.highCutSlope);
+        }
+
+        beginTest("Matching a three minute file");
+        {
+            juce::TemporaryFile longReferenceFile(".wav"), longTargetFile(".wav");
+            expect(writeTestFiles(longReferenceFile.getFile(), longTargetFile.getFile(), known, 180.0));
+
+            ReferenceMatcher matcher;
+            ChainSettings matched;
+
+            auto start = juce::Time::getHighResolutionTicks();
+            auto result = matcher.match(longReferenceFile.getFile(), longTargetFile.getFile(), matched);
+            auto elapsed = juce::Time::highResolutionTicksToSeconds(juce::Time::getHighResolutionTicks() - start);
+
+            expect(result.wasOk(), result.getErrorMessage());
+
+            logMessage(juce::String::formatted("180 s stereo at 44.1 kHz matched in %.2f s on %d threads",
+                                               elapsed, matcher.threadPool.getNumThreads()));
+
+            // A few seconds even on one core, so this leaves room for a slow machine. Debug
+            // builds aren't optimised, so there the time is only logged.
+           #if ! JUCE_DEBUG
+            expectLessThan(elapsed, 10.0);
+           #endif
+        }
+    }
+
+private:
+    static constexpr double sampleRate = 44100.0;
+    static constexpr int numChannels = 2;
+
+    // Streams white noise to the target file and the same noise, run through the processor with
+    // the given settings, to the reference file.
+    static bool writeTestFiles(const juce::File& referenceFile, const juce::File& targetFile,
+                               const ChainSettings& settings, double lengthInSeconds)
+    {
+        constexpr int blockSize = 4096;
+
+        auto referenceWriter = createWriter(referenceFile);
+        auto targetWriter = createWriter(targetFile);
+
+        if (referenceWriter == nullptr || targetWriter == nullptr)
+            return false;
+
+        SimpleEQ_SCAudioProcessor processor;
+        setChainSettings(processor.apvts, settings);
+        processor.setRateAndBufferSizeDetails(sampleRate, blockSize);
+        processor.prepareToPlay(sampleRate, blockSize);
+
+        juce::AudioBuffer<float> noise(numChannels, blockSize), filtered(numChannels, blockSize);
+        juce::MidiBuffer midiMessages;
+        juce::Random random(0x3b);
+
+        for (auto remaining = (juce::int64) (lengthInSeconds * sampleRate); remaining > 0; remaining -= blockSize)
+        {
+            auto numSamples = (int) juce::jmin<juce::int64>(remaining, blockSize);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                for (int sample = 0; sample < blockSize; ++sample)
+                    noise.setSample(channel, sample, (random.nextFloat() * 2.f - 1.f) * 0.25f);
+
+            filtered.makeCopyOf(noise);
+            processor.processBlock(filtered, midiMessages);
+
+            if (! targetWriter->writeFromAudioSampleBuffer(noise, 0, numSamples)
+                || ! referenceWriter->writeFromAudioSampleBuffer(filtered, 0, numSamples))
+                return false;
+        }
+
+        return true;
+    }
+
+    static std::unique_ptr<juce::AudioFormatWriter> createWriter(const juce::File& file)
+    {
+        auto stream = std::make_unique<juce::FileOutputStream>(file);
+
+        if (stream->failedToOpen())
+            return nullptr;
+
+        // 32 bit float, so the deep stopbands aren't buried in quantisation noise.
+        juce::WavAudioFormat format;
+        std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(stream.get(), sampleRate,
+                                                                               (unsigned int) numChannels, 32, {}, 0));
+
+        if (writer != nullptr)
+            stream.release();
+
+        return writer;
+    }
+
+    static ReferenceMatcher::LongTermSpectrum analyse(ReferenceMatcher& matcher, const juce::File& file)
+    {
+        juce::OwnedArray<ReferenceMatcher::SpectrumJob> jobs;
+        double fileSampleRate = 0.0;
+
+        matcher.analyse(file, jobs, fileSampleRate);
+
+        return matcher.collect(jobs, fileSampleRate);
+    }
+
+    static double getOctaves(float value, float expected)
+    {
+        return std::abs(std::log2(double(value) / double(expected)));
+    }
+
+    static juce::String toString(const ChainSettings& settings)
+    {
+        return juce::String::formatted("Low cut %.1f Hz, %d dB/oct; high cut %.1f Hz, %d dB/oct; peak %.1f Hz, %.2f dB, Q %.2f",
+                                       settings.lowCutFreq, 12 * (settings.lowCutSlope + 1),
+                                       settings.highCutFreq, 12 * (settings.highCutSlope + 1),
+                                       settings.peakFreq, settings.peakGainInDecibels, settings.peakQ);
+    }
+};
+
+static ReferenceMatcherTests referenceMatcherTests;
+
+#endif
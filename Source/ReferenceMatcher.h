@@ -0,0 +1,64 @@
+/*
+  ==============================================================================
+
+    Fits the band settings so that a target file, run through the EQ, matches
+    the long-term average spectrum of a reference file.
+
+  ==============================================================================
+*/
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+//==============================================================================
+/**
+    Streams both files in blocks of one FFT hop, so memory use does not grow with
+    the track length. Each file is split into segments that are analysed in
+    parallel on a thread pool, and the difference curve is then fitted with the
+    same coefficient design the processor uses.
+
+    Needs neither an editor nor an audio device, so it can be used from batch jobs.
+    match() blocks the calling thread until the fit is done.
+*/
+class ReferenceMatcher
+{
+public:
+    explicit ReferenceMatcher(int numThreads = juce::SystemStats::getNumCpus());
+    ~ReferenceMatcher();
+
+    juce::Result match(const juce::File& referenceFile, const juce::File& targetFile, ChainSettings& settings);
+
+private:
+    friend class ReferenceMatcherTests;
+
+    class SpectrumJob;
+
+    struct LongTermSpectrum
+    {
+        std::vector<double> power; // mean power per FFT bin
+        double sampleRate = 0.0;
+    };
+
+    struct FitPoint
+    {
+        double frequency;
+        double phi; // sin^2 (omega / 2) at the target's sample rate
+        double differenceInDecibels;
+        double weight;
+    };
+
+    juce::AudioFormatManager formatManager;
+    juce::ThreadPool threadPool;
+
+    juce::Result analyse(const juce::File& file, juce::OwnedArray<SpectrumJob>& jobs, double& sampleRate);
+    LongTermSpectrum collect(juce::OwnedArray<SpectrumJob>& jobs, double sampleRate);
+
+    static std::vector<FitPoint> makeFitPoints(const LongTermSpectrum& reference, const LongTermSpectrum& target);
+    static ChainSettings fit(const std::vector<FitPoint>& points, double sampleRate);
+    static double getFitError(const std::vector<FitPoint>& points, const ChainSettings& settings, double sampleRate,
+                              std::vector<double>& deviations);
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ReferenceMatcher)
+};